@@ -6,6 +6,20 @@
 #include <vector>
 #include <algorithm>
 #include <stdexcept>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define HAVE_MMAP 1
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define HAVE_SSE2 1
+#endif
 using namespace std;
 #pragma pack(1)
 
@@ -239,7 +253,8 @@ bool isValidInputFileName2(char* filename) {
 bool isValidCommand(const char* command) {
     vector<string> validCommands = {
             "multiply", "subtract", "overlay", "screen", "combine", "flip","onlyred", "onlygreen", "onlyblue",
-            "addred", "addgreen", "addblue", "scalered", "scalegreen", "scaleblue"
+            "addred", "addgreen", "addblue", "scalered", "scalegreen", "scaleblue",
+            "compare", "identical", "diff"
     };
     for(int i = 0; i < validCommands.size(); i++){
         if(validCommands[i] == std::string(command)){
@@ -249,6 +264,235 @@ bool isValidCommand(const char* command) {
     return false;
 }
 
+////////////////////////////// COMPARE //////////////////////////////////////
+// Read-only view of a tga file. Uses mmap where available so comparing big
+// golden images doesn't copy them into a vector first.
+struct MappedImage {
+    Header header;
+    const unsigned char* pixels = nullptr;
+    size_t pixelBytes = 0;
+    void* mapping = nullptr;
+    size_t mappingSize = 0;
+    vector<unsigned char> buffer; // fallback when mmap isn't available
+
+    MappedImage() = default;
+    MappedImage(const MappedImage&) = delete;
+    MappedImage& operator=(const MappedImage&) = delete;
+    ~MappedImage() {
+#ifdef HAVE_MMAP
+        if (mapping != nullptr) {
+            munmap(mapping, mappingSize);
+        }
+#endif
+    }
+};
+
+bool mapFile(const string& fileName, MappedImage& image) {
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+#ifdef HAVE_MMAP
+    int fd = open(fileName.c_str(), O_RDONLY);
+    if (fd < 0) {
+        cerr << "Failed to open file: " << fileName << endl;
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < (off_t)sizeof(Header)) {
+        close(fd);
+        cerr << "Invalid tga file: " << fileName << endl;
+        return false;
+    }
+    size = info.st_size;
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        cerr << "Failed to map file: " << fileName << endl;
+        return false;
+    }
+    image.mapping = mapping;
+    image.mappingSize = size;
+    data = static_cast<const unsigned char*>(mapping);
+#else
+    ifstream file(fileName, ios::binary);
+    if (!file.is_open()) {
+        cerr << "Failed to open file: " << fileName << endl;
+        return false;
+    }
+    image.buffer.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+    data = image.buffer.data();
+    size = image.buffer.size();
+    if (size < sizeof(Header)) {
+        cerr << "Invalid tga file: " << fileName << endl;
+        return false;
+    }
+#endif
+    memcpy(&image.header, data, sizeof(Header));
+    // Only uncompressed true color images are compared byte for byte; RLE,
+    // color mapped or 32 bit files would give meaningless results.
+    if (image.header.dataTypeCode != 2 || image.header.colorMapType != 0
+        || (unsigned char)image.header.bitsPerPixel != 24) {
+        cerr << "Unsupported tga (expected uncompressed 24 bit, no color map): " << fileName << endl;
+        return false;
+    }
+    size_t offset = sizeof(Header) + (unsigned char)image.header.idLength;
+    size_t pixelBytes = (size_t)image.header.width * image.header.height * 3;
+    if (image.header.width < 0 || image.header.height < 0 || offset + pixelBytes > size) {
+        cerr << "Invalid tga file: " << fileName << endl;
+        return false;
+    }
+    image.pixels = data + offset;
+    image.pixelBytes = pixelBytes;
+    return true;
+}
+
+// Result of the compare methods, also used as the exit status of the program.
+enum CompareStatus {
+    IMAGES_IDENTICAL = 0,
+    IMAGES_DIFFER = 1,
+    COMPARE_ERROR = 2
+};
+
+struct CompareResult {
+    long long mismatchedPixels = 0;
+    int maxDifference = 0;
+    unsigned long long sumSquaredDifference = 0;
+    int minX = 0, minY = 0, maxX = -1, maxY = -1; // bounding box of differing pixels
+};
+
+// Compares one row of bytes. Returns true if any byte differs. When stats is
+// false this stops at the first differing 16 byte block.
+bool compareRow(const unsigned char* a, const unsigned char* b, size_t n, bool stats,
+                int& maxDifference, unsigned long long& sumSquared) {
+    bool differs = false;
+    size_t i = 0;
+#ifdef HAVE_SSE2
+    __m128i zero = _mm_setzero_si128();
+    __m128i maxVec = zero;
+    __m128i sumVec = zero; // 4 x 32 bit, a row is at most ~6k blocks so this can't overflow
+    for (; i + 16 <= n; i += 16) {
+        __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)) == 0xFFFF) {
+            continue;
+        }
+        differs = true;
+        if (!stats) {
+            return true;
+        }
+        __m128i absDiff = _mm_or_si128(_mm_subs_epu8(va, vb), _mm_subs_epu8(vb, va));
+        maxVec = _mm_max_epu8(maxVec, absDiff);
+        __m128i lo = _mm_unpacklo_epi8(absDiff, zero);
+        __m128i hi = _mm_unpackhi_epi8(absDiff, zero);
+        sumVec = _mm_add_epi32(sumVec, _mm_madd_epi16(lo, lo));
+        sumVec = _mm_add_epi32(sumVec, _mm_madd_epi16(hi, hi));
+    }
+    if (differs) {
+        unsigned char maxBytes[16];
+        unsigned int sums[4];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(maxBytes), maxVec);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(sums), sumVec);
+        for (int k = 0; k < 16; k++) {
+            maxDifference = max(maxDifference, (int)maxBytes[k]);
+        }
+        for (int k = 0; k < 4; k++) {
+            sumSquared += sums[k];
+        }
+    }
+#endif
+    for (; i < n; i++) {
+        int difference = abs(a[i] - b[i]);
+        if (difference == 0) {
+            continue;
+        }
+        differs = true;
+        if (!stats) {
+            return true;
+        }
+        maxDifference = max(maxDifference, difference);
+        sumSquared += difference * difference;
+    }
+    return differs;
+}
+
+// Compares two images row by row. Identical rows only go through the SIMD
+// check; rows that differ get a second per-pixel pass for the count and box.
+// With stopAtFirst the scan ends at the first difference and only
+// mismatchedPixels (0 or 1) is meaningful.
+CompareResult compareImages(const MappedImage& image, const MappedImage& reference, bool stopAtFirst) {
+    CompareResult result;
+    int width = image.header.width;
+    int height = image.header.height;
+    size_t rowBytes = (size_t)width * 3;
+    for (int y = 0; y < height; y++) {
+        const unsigned char* a = image.pixels + y * rowBytes;
+        const unsigned char* b = reference.pixels + y * rowBytes;
+        if (!compareRow(a, b, rowBytes, !stopAtFirst, result.maxDifference, result.sumSquaredDifference)) {
+            continue;
+        }
+        if (stopAtFirst) {
+            result.mismatchedPixels = 1;
+            return result;
+        }
+        for (int x = 0; x < width; x++) {
+            const unsigned char* pa = a + x * 3;
+            const unsigned char* pb = b + x * 3;
+            if (pa[0] == pb[0] && pa[1] == pb[1] && pa[2] == pb[2]) {
+                continue;
+            }
+            if (result.mismatchedPixels == 0) {
+                result.minX = result.maxX = x;
+                result.minY = result.maxY = y;
+            }
+            result.mismatchedPixels++;
+            result.minX = min(result.minX, x);
+            result.maxX = max(result.maxX, x);
+            result.minY = min(result.minY, y);
+            result.maxY = max(result.maxY, y);
+        }
+    }
+    return result;
+}
+
+// Differing pixels are drawn red with brightness based on the largest channel
+// difference; matching pixels are the reference in dim grayscale. Sets
+// differs if any pixel was different.
+vector<unsigned char> diffImage(const MappedImage& image, const MappedImage& reference, bool& differs) {
+    vector<unsigned char> result(image.pixelBytes);
+    differs = false;
+    for (size_t i = 0; i < image.pixelBytes; i += 3) {
+        const unsigned char* a = image.pixels + i;
+        const unsigned char* b = reference.pixels + i;
+        int difference = max(abs(a[0] - b[0]), max(abs(a[1] - b[1]), abs(a[2] - b[2])));
+        if (difference == 0) {
+            unsigned char gray = (unsigned char)((b[0] + b[1] + b[2]) / 9);
+            result[i] = gray;
+            result[i + 1] = gray;
+            result[i + 2] = gray;
+        } else {
+            differs = true;
+            result[i] = 0;                                  // blue
+            result[i + 1] = 0;                              // green
+            result[i + 2] = (unsigned char)(128 + difference / 2); // red
+        }
+    }
+    return result;
+}
+
+// Pixel order bits of imageDescriptor (bit 4 right-to-left, bit 5 top-down).
+const char ORIGIN_BITS = 0x30;
+
+bool sameLayout(const MappedImage& image, const MappedImage& reference) {
+    if (image.header.width != reference.header.width || image.header.height != reference.header.height) {
+        cerr << "Images have different dimensions." << endl;
+        return false;
+    }
+    if ((image.header.imageDescriptor & ORIGIN_BITS) != (reference.header.imageDescriptor & ORIGIN_BITS)) {
+        cerr << "Images have different pixel origins." << endl;
+        return false;
+    }
+    return true;
+}
+
 
 ////////////////////////////// COMMANDS /////////////////////////////////////
 void multiply(const char* outputFilename, const char* firstImageFilename, const char* secondImageFilename) {
@@ -386,7 +630,77 @@ void screenM(const char* outputFilename, const char* inputFilename1, const char*
 
 
 
+// Prints mismatch count, max difference, PSNR and the bounding box of the
+// differences. The box is in viewer coordinates, row 0 is the top row.
+CompareStatus compare(const char* inputFilename, const char* referenceFilename) {
+    MappedImage image, reference;
+    if (!mapFile(inputFilename, image) || !mapFile(referenceFilename, reference)) {
+        return COMPARE_ERROR;
+    }
+    if (!sameLayout(image, reference)) {
+        return COMPARE_ERROR;
+    }
+    CompareResult result = compareImages(image, reference, false);
+    double psnr = numeric_limits<double>::infinity();
+    if (result.sumSquaredDifference > 0) {
+        double mse = (double)result.sumSquaredDifference / image.pixelBytes;
+        psnr = 10.0 * log10((255.0 * 255.0) / mse);
+    }
+    cout << "Mismatched pixels: " << result.mismatchedPixels << endl;
+    cout << "Max difference: " << result.maxDifference << endl;
+    cout << "PSNR: " << psnr << endl;
+    if (result.mismatchedPixels > 0) {
+        int left = result.minX, right = result.maxX;
+        if (image.header.imageDescriptor & 0x10) {
+            // columns are stored right-to-left
+            left = image.header.width - 1 - result.maxX;
+            right = image.header.width - 1 - result.minX;
+        }
+        int top = result.minY, bottom = result.maxY;
+        if ((image.header.imageDescriptor & 0x20) == 0) {
+            // rows are stored bottom-up
+            top = image.header.height - 1 - result.maxY;
+            bottom = image.header.height - 1 - result.minY;
+        }
+        cout << "Bounding box: " << left << "," << top << " - "
+             << right << "," << bottom << endl;
+    }
+    return result.mismatchedPixels == 0 ? IMAGES_IDENTICAL : IMAGES_DIFFER;
+}
+
+// Early exit check, stops at the first differing block.
+CompareStatus identical(const char* inputFilename, const char* referenceFilename) {
+    MappedImage image, reference;
+    if (!mapFile(inputFilename, image) || !mapFile(referenceFilename, reference)) {
+        return COMPARE_ERROR;
+    }
+    if (!sameLayout(image, reference)) {
+        return COMPARE_ERROR;
+    }
+    bool same = compareImages(image, reference, true).mismatchedPixels == 0;
+    cout << (same ? "Images are identical." : "Images differ.") << endl;
+    return same ? IMAGES_IDENTICAL : IMAGES_DIFFER;
+}
 
+CompareStatus diff(const char* outputFilename, const char* inputFilename, const char* referenceFilename) {
+    MappedImage image, reference;
+    if (!mapFile(inputFilename, image) || !mapFile(referenceFilename, reference)) {
+        return COMPARE_ERROR;
+    }
+    if (!sameLayout(image, reference)) {
+        return COMPARE_ERROR;
+    }
+    bool differs;
+    vector<unsigned char> diffData = diffImage(image, reference, differs);
+    Header diffHeader = {};
+    diffHeader.dataTypeCode = 2;
+    diffHeader.width = image.header.width;
+    diffHeader.height = image.header.height;
+    diffHeader.bitsPerPixel = 24;
+    diffHeader.imageDescriptor = image.header.imageDescriptor & ORIGIN_BITS;
+    writeFile(outputFilename, diffHeader, diffData);
+    return differs ? IMAGES_DIFFER : IMAGES_IDENTICAL;
+}
 
 int main(int argc, char* argv[]) {
     // Check for help message or insufficient arguments
@@ -395,6 +709,23 @@ int main(int argc, char* argv[]) {
         cout << endl;
         cout << "Usage:" << endl;
         cout << "\t./project2.out [output] [firstImage] [method] [...]" << endl;
+        cout << endl;
+        cout << "Compare methods (the tracking image against a reference):" << endl;
+        cout << "\tcompare [reference]    print mismatched pixels, max difference, PSNR and" << endl;
+        cout << "\t                       bounding box (x0,y0 - x1,y1, 0,0 is the top left)" << endl;
+        cout << "\tidentical [reference]  print \"Images are identical.\" or \"Images differ.\"," << endl;
+        cout << "\t                       stops at the first difference" << endl;
+        cout << "\tdiff [reference] [diffImage]" << endl;
+        cout << "\t                       write a diff image to [diffImage], differing pixels red;" << endl;
+        cout << "\t                       [output] and the tracking image are left untouched" << endl;
+        cout << "\tOnly uncompressed 24 bit tga files are supported." << endl;
+        cout << endl;
+        cout << "Exit status:" << endl;
+        cout << "\t0  success, all compared images identical" << endl;
+        cout << "\t1  a compared image differs from its reference, or an argument error" << endl;
+        cout << "\t   in another method" << endl;
+        cout << "\t2  error in a compare method (bad arguments, missing, unsupported or" << endl;
+        cout << "\t   mismatched files)" << endl;
         return 0;
     }
 
@@ -417,6 +748,7 @@ int main(int argc, char* argv[]) {
     }
 
     const char* trackingImage = argv[2]; // Initial source image
+    CompareStatus status = IMAGES_IDENTICAL; // set by compare, identical and diff
 
     int i = 3; // Start from the first method argument
     while (i < argc) {
@@ -648,10 +980,55 @@ int main(int argc, char* argv[]) {
             combine(argv[1], trackingImage, argv[i+1], argv[i+2]);
             trackingImage = argv[1];
         }
+        else if (strcmp(argv[i], "compare") == 0 || strcmp(argv[i], "identical") == 0
+                 || strcmp(argv[i], "diff") == 0) {
+            if (argv[i+1] == nullptr) {
+                cout << "Missing argument." << endl;
+                return COMPARE_ERROR;
+            }
+            if (!isValidInputFileName2(argv[i+1])) {
+                cout << "Invalid argument, invalid file name." << endl;
+                return COMPARE_ERROR;
+            }
+            bool isDiff = strcmp(argv[i], "diff") == 0;
+            if (isDiff) {
+                if (argv[i+2] == nullptr) {
+                    cout << "Missing argument." << endl;
+                    return COMPARE_ERROR;
+                }
+                if (!isValidOutputFileName(argv[i+2])) {
+                    cout << "Invalid argument, invalid file name." << endl;
+                    return COMPARE_ERROR;
+                }
+                // the diff must not replace the image being checked
+                if (strcmp(argv[i+2], argv[1]) == 0 || strcmp(argv[i+2], trackingImage) == 0
+                    || strcmp(argv[i+2], argv[i+1]) == 0) {
+                    cout << "Invalid argument, diff image must be a separate file." << endl;
+                    return COMPARE_ERROR;
+                }
+            }
+            CompareStatus result;
+            if (strcmp(argv[i], "compare") == 0) {
+                result = compare(trackingImage, argv[i+1]);
+            }
+            else if (strcmp(argv[i], "identical") == 0) {
+                result = identical(trackingImage, argv[i+1]);
+            }
+            else {
+                result = diff(argv[i+2], trackingImage, argv[i+1]);
+            }
+            if (result == COMPARE_ERROR) {
+                return COMPARE_ERROR;
+            }
+            if (result == IMAGES_DIFFER) {
+                status = IMAGES_DIFFER;
+            }
+            i += isDiff ? 2 : 1; // skip the reference and diff file names
+        }
 
         // Move to the next method argument
         i++;
     }
 
-    return 0;
+    return status;
 }